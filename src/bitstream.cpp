@@ -1,11 +1,99 @@
+#ifdef HAVE_CONFIG_H
+#   include "config.h"
+#endif
+
 #include "bitstream.hpp"
 
 #include <streambuf>
 #include <ostream>
 #include <vector>
+#include <mutex>
+#include <atomic>
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+#ifdef BITSTREAM_STATS
+#   define BITSTREAM_COUNT_IO(STATS, POS, BITS) count_io((STATS), (POS), (BITS))
+#   define BITSTREAM_COUNT_OVERRUN(STATS, POS, BITS) \
+    do { ++(STATS).overruns; trace(org::sqg::BITSTREAM_OVERRUN, (POS), (BITS)); } while (0)
+#   define BITSTREAM_COUNT_GROWTH(STATS, POS, COPIED) \
+    do { \
+        ++(STATS).growths; \
+        (STATS).bytes_copied += (COPIED); \
+        trace(org::sqg::BITSTREAM_GROWTH, (POS), (COPIED)); \
+    } while (0)
+#   define BITSTREAM_PUBLISH(STATS) publish(STATS)
+#else
+#   define BITSTREAM_COUNT_IO(STATS, POS, BITS) ((void) 0)
+#   define BITSTREAM_COUNT_OVERRUN(STATS, POS, BITS) ((void) 0)
+#   define BITSTREAM_COUNT_GROWTH(STATS, POS, COPIED) ((void) 0)
+#   define BITSTREAM_PUBLISH(STATS) ((void) 0)
+#endif
+
+namespace {
+
+    // digest of the bytes from `digested` up to bit `pos`, a trailing
+    // partial byte taken only as far as its written bits.
+    std::uint64_t finish_digest(org::sqg::checksum c, org::sqg::byte const *bytes,
+            std::size_t digested, std::size_t pos) {
+        std::size_t end = pos >> 3;
+        if (end < digested)
+            return c.digest();
+        c.update(bytes + digested, end - digested);
+        if (pos & 0x7) {
+            org::sqg::byte last = bytes[end] & (0xff << (8 - (pos & 0x7)));
+            c.update(&last, 1);
+        }
+        return c.digest();
+    }
+
+    std::mutex GLOBAL_STATS_MUTEX;
+    org::sqg::bitstream_stats GLOBAL_STATS;
+    std::atomic<org::sqg::bitstream_trace_hook> TRACE_HOOK(NULL);
+
+#ifdef BITSTREAM_STATS
+    void trace(org::sqg::bitstream_event event, std::size_t pos, std::size_t value) {
+        org::sqg::bitstream_trace_hook hook = TRACE_HOOK.load(std::memory_order_relaxed);
+        if (hook)
+            hook(event, pos, value);
+    }
+
+    void publish(org::sqg::bitstream_stats const &stats) {
+        std::lock_guard<std::mutex> lock(GLOBAL_STATS_MUTEX);
+        GLOBAL_STATS += stats;
+    }
+
+    void count_io(org::sqg::bitstream_stats &stats, std::size_t pos, std::size_t bits) {
+        using org::sqg::bitstream_stats;
+        std::size_t bucket = bitstream_stats::WIDTH_33_64;
+        if (bits <= 1)
+            bucket = bitstream_stats::WIDTH_1;
+        else if (bits <= 8)
+            bucket = bitstream_stats::WIDTH_2_8;
+        else if (bits <= 16)
+            bucket = bitstream_stats::WIDTH_9_16;
+        else if (bits <= 32)
+            bucket = bitstream_stats::WIDTH_17_32;
+        ++stats.calls[bucket];
+        stats.bits += bits;
+        if (pos & 0x7)
+            ++stats.unaligned;
+        else
+            ++stats.aligned;
+    }
+#endif
+}
 
 struct org::sqg::obitstream::impl {
 
+    impl() :_M_digested(0) { }
+
+    virtual ~impl() { BITSTREAM_PUBLISH(_M_stats); }
+
+    virtual std::size_t tell() const = 0;
+
     virtual void seek(std::streamoff, std::ios::seekdir dir) = 0;
 
     virtual void* data() = 0;
@@ -20,27 +108,39 @@ struct org::sqg::obitstream::impl {
 
     virtual void write_uint0(uint64_t, size_t) = 0;
 
+    void overrun(size_t bits) {
+        BITSTREAM_COUNT_OVERRUN(_M_stats, tell(), bits);
+        throw bitstream_error();
+    }
+
     void write_bit(size_t bit) {
         if (!ensure_more_space(1))
-            throw bitstream_error();
+            overrun(1);
+        BITSTREAM_COUNT_IO(_M_stats, tell(), 1);
         write_bit0(bit);
+        fold();
     };
 
     virtual void write_int(int64_t value, size_t bits) {
         if (!ensure_more_space(bits))
-            throw bitstream_error();
+            overrun(bits);
+        BITSTREAM_COUNT_IO(_M_stats, tell(), bits);
         write_uint0(value, bits);
+        fold();
     }
 
     virtual void write_uint(uint64_t value, size_t bits) {
         if (!ensure_more_space(bits))
-            throw bitstream_error();
+            overrun(bits);
+        BITSTREAM_COUNT_IO(_M_stats, tell(), bits);
         write_uint0(value, bits);
+        fold();
     }
 
     virtual void write_intS(int64_t value, size_t bits) {
         if (!ensure_more_space(bits))
-            throw bitstream_error();
+            overrun(bits);
+        BITSTREAM_COUNT_IO(_M_stats, tell(), bits);
         if (value < 0) {
             write_bit0(1);
             write_uint0(-value, bits - 1);
@@ -48,7 +148,34 @@ struct org::sqg::obitstream::impl {
             write_bit0(0);
             write_uint0(value, bits - 1);
         }
+        fold();
+    }
+
+    void begin_checksum(org::sqg::checksum::algorithm algo, std::uint64_t seed) {
+        _M_checksum = org::sqg::checksum(algo, seed);
+        _M_digested = tell() >> 3;
+    }
+
+    // feed the bytes completed since the last call into the checksum.
+    void fold() {
+        if (!_M_checksum.enabled())
+            return;
+        std::size_t end = tell() >> 3;
+        if (end > _M_digested) {
+            _M_checksum.update(static_cast<org::sqg::byte const*>(data()) + _M_digested,
+                    end - _M_digested);
+            _M_digested = end;
+        }
     }
+
+    std::uint64_t digest() const {
+        return finish_digest(_M_checksum, static_cast<org::sqg::byte const*>(data()),
+                _M_digested, tell());
+    }
+
+    org::sqg::bitstream_stats _M_stats;
+    org::sqg::checksum _M_checksum;
+    std::size_t _M_digested;
 };
 
 namespace {
@@ -75,6 +202,21 @@ namespace {
         (~(0x1 << 3)) & 0xff, (~(0x1 << 2)) & 0xff, (~(0x1 << 1)) & 0xff, (~(0x1 << 0)) & 0xff,
     };
 
+    // the `bits` bits at bit offset `off`, which must lie within the buffer.
+    std::uint64_t peek(org::sqg::byte const *bytes, std::size_t off, std::size_t bits) {
+        std::size_t first = off >> 3;
+        std::size_t n = ((off + bits - 1) >> 3) - first + 1;
+        std::size_t s = off & 0x7;
+        std::uint64_t v = 0;
+        for (std::size_t k = 0; k < n && k < 8; ++k)
+            v = (v << 8) | bytes[first + k];
+        if (n > 8)
+            v = (v << s) | (bytes[first + 8] >> (8 - s));
+        else
+            v <<= 64 - n * 8 + s;
+        return v >> (64 - bits);
+    }
+
     struct no_delete {
         void operator () (void *p) { }
         void operator () (void const *p) { }
@@ -112,6 +254,8 @@ namespace {
             }
         }
 
+        virtual std::size_t tell() const { return _M_pos; }
+
         virtual void* data() { return _M_bytes; }
 
         virtual void const* data() const { return _M_bytes; }
@@ -211,6 +355,8 @@ namespace {
             }
         }
 
+        virtual std::size_t tell() const { return _M_pos; }
+
         virtual void* data() { return &_M_data[0]; }
 
         virtual void const* data() const { return &_M_data[0]; }
@@ -219,6 +365,7 @@ namespace {
 
         virtual bool ensure_more_space(size_t n) {
             if (_M_pos + n > _M_size) {
+                BITSTREAM_COUNT_GROWTH(_M_stats, _M_pos, _M_data.size());
                 _M_data.resize(_M_size >> 2);
                 _M_size <<= 1;
             }
@@ -285,6 +432,51 @@ namespace {
 namespace org {
     namespace sqg {
 
+        void bitstream_stats::reset() {
+            bits = 0;
+            for (std::size_t i = 0; i < WIDTH_BUCKETS; ++i)
+                calls[i] = 0;
+            aligned = 0;
+            unaligned = 0;
+            growths = 0;
+            bytes_copied = 0;
+            overruns = 0;
+        }
+
+        bitstream_stats& bitstream_stats::operator += (bitstream_stats const &other) {
+            bits += other.bits;
+            for (std::size_t i = 0; i < WIDTH_BUCKETS; ++i)
+                calls[i] += other.calls[i];
+            aligned += other.aligned;
+            unaligned += other.unaligned;
+            growths += other.growths;
+            bytes_copied += other.bytes_copied;
+            overruns += other.overruns;
+            return *this;
+        }
+
+        bool bitstream_stats::enabled() {
+#ifdef BITSTREAM_STATS
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        bitstream_trace_hook set_bitstream_trace_hook(bitstream_trace_hook hook) {
+            return TRACE_HOOK.exchange(hook);
+        }
+
+        bitstream_stats global_bitstream_stats() {
+            std::lock_guard<std::mutex> lock(GLOBAL_STATS_MUTEX);
+            return GLOBAL_STATS;
+        }
+
+        void reset_global_bitstream_stats() {
+            std::lock_guard<std::mutex> lock(GLOBAL_STATS_MUTEX);
+            GLOBAL_STATS.reset();
+        }
+
         obitstream::obitstream(
                 std::shared_ptr<byte> const &mem,
                 std::size_t size)
@@ -308,6 +500,35 @@ namespace org {
             return _M_data->size();
         }
 
+        bitstream_stats const& obitstream::stats() const {
+            return _M_data->_M_stats;
+        }
+
+        obitstream& obitstream::publish_stats() {
+            BITSTREAM_PUBLISH(_M_data->_M_stats);
+            _M_data->_M_stats.reset();
+            return *this;
+        }
+
+        obitstream& obitstream::begin_checksum(checksum::algorithm algo, std::uint64_t seed) {
+            _M_data->begin_checksum(algo, seed);
+            return *this;
+        }
+
+        std::uint64_t obitstream::digest() const {
+            return _M_data->digest();
+        }
+
+        obitstream& obitstream::write_digest() {
+            if (!_M_data->_M_checksum.enabled())
+                throw std::logic_error("write_digest() without begin_checksum()");
+            std::size_t rem = _M_data->tell() & 0x7;
+            if (rem != 0)
+                _M_data->write_uint(0, 8 - rem);
+            _M_data->write_uint(_M_data->digest(), _M_data->_M_checksum.bits());
+            return *this;
+        }
+
         obitstream& obitstream::write_bit(std::size_t bit) {
             _M_data->write_bit(bit);
             return *this;
@@ -352,29 +573,52 @@ namespace org {
             :_M_sptr(mem),
             _M_bytes(mem.get()),
             _M_size(size),
-            _M_pos(0)
+            _M_pos(0),
+            _M_digested(0)
         {
         }
 
         ibitstream::~ibitstream() {
+            BITSTREAM_PUBLISH(_M_stats);
             _M_sptr.reset();
             _M_bytes = NULL;
             _M_size = 0;
         }
 
+        void ibitstream::require(std::size_t bits) {
+            if (_M_pos + bits > _M_size) {
+                BITSTREAM_COUNT_OVERRUN(_M_stats, _M_pos, bits);
+                throw bitstream_error();
+            }
+            BITSTREAM_COUNT_IO(_M_stats, _M_pos, bits);
+        }
+
+        ibitstream& ibitstream::publish_stats() {
+            BITSTREAM_PUBLISH(_M_stats);
+            _M_stats.reset();
+            return *this;
+        }
+
         size_t ibitstream::read_bit() {
             size_t bit = 0;
-            if (_M_pos + 1 > _M_size)
-                throw bitstream_error();
+            require(1);
             bit = (_M_bytes[_M_pos >> 3] >> ((~_M_pos) & 0x7)) & 0x1;
             ++_M_pos;
+            if (_M_checksum.enabled())
+                fold();
             return bit;
         }
 
         std::uint64_t ibitstream::read_uint(std::size_t bits) {
+            require(bits);
+            std::uint64_t r = read_uint0(bits);
+            if (_M_checksum.enabled())
+                fold();
+            return r;
+        }
+
+        std::uint64_t ibitstream::read_uint0(std::size_t bits) {
             std::uint64_t r = 0;
-            if (_M_pos + bits > _M_size)
-                throw bitstream_error();
             while (bits > 0) {
                 if (_M_pos % 8 == 0) {
                     while (bits >= 8) {
@@ -411,27 +655,157 @@ namespace org {
             return r;
         }
 
+        void ibitstream::fold() {
+            std::size_t end = _M_pos >> 3;
+            if (end > _M_digested) {
+                _M_checksum.update(_M_bytes + _M_digested, end - _M_digested);
+                _M_digested = end;
+            }
+        }
+
+        ibitstream& ibitstream::begin_checksum(checksum::algorithm algo, std::uint64_t seed) {
+            _M_checksum = checksum(algo, seed);
+            _M_digested = _M_pos >> 3;
+            return *this;
+        }
+
+        std::uint64_t ibitstream::digest() const {
+            return finish_digest(_M_checksum, _M_bytes, _M_digested, _M_pos);
+        }
+
+        bool ibitstream::verify_digest() {
+            if (!_M_checksum.enabled())
+                throw std::logic_error("verify_digest() without begin_checksum()");
+            std::size_t rem = _M_pos & 0x7;
+            if (rem != 0)
+                read_uint(8 - rem);
+            std::uint64_t expected = digest();
+            return read_uint(_M_checksum.bits()) == expected;
+        }
+
         std::int64_t ibitstream::read_int(std::size_t bits) {
             std::int64_t r = 0;
-            if (read_bit()) {
+            if (bits == 0)
+                throw bitstream_error();
+            require(bits);
+            if (read_uint0(1)) {
                 // negative
                 r = -1;
                 r <<= (bits - 1);
             }
-            r |= read_uint(bits - 1);
+            r |= read_uint0(bits - 1);
+            if (_M_checksum.enabled())
+                fold();
             return r;
         }
 
         std::int64_t ibitstream::read_intS(std::size_t bits) {
             std::int64_t r = 0;
-            if (read_bit()) {
-                r = -read_uint(bits - 1);
+            if (bits == 0)
+                throw bitstream_error();
+            require(bits);
+            if (read_uint0(1)) {
+                r = -read_uint0(bits - 1);
             } else {
-                r |= read_uint(bits - 1);
+                r |= read_uint0(bits - 1);
             }
+            if (_M_checksum.enabled())
+                fold();
             return r;
         }
 
+        std::size_t ibitstream::find(std::uint64_t pattern, std::size_t bits, std::size_t from) const {
+            return scan(pattern, bits, from, NULL);
+        }
+
+        std::vector<std::size_t> ibitstream::find_all(std::uint64_t pattern, std::size_t bits,
+                std::size_t from) const {
+            std::vector<std::size_t> all;
+            scan(pattern, bits, from, &all);
+            return all;
+        }
+
+        std::size_t ibitstream::scan(std::uint64_t pattern, std::size_t bits, std::size_t from,
+                std::vector<std::size_t> *all) const {
+            if (bits == 0 || bits > 64)
+                throw std::invalid_argument("pattern must be 1 to 64 bits");
+            if (bits < 64)
+                pattern &= (std::uint64_t(1) << bits) - 1;
+            if (from > _M_size || _M_size - from < bits)
+                return npos;
+            std::size_t const last = _M_size - bits;   // last offset a match may start at
+            std::size_t const nbytes = (_M_size + 7) >> 3;
+            std::size_t i = from >> 3;
+
+            if (bits < 15) {
+                // too short to pin a whole byte at every shift, test each offset.
+                for (std::size_t off = from; off <= last; ++off) {
+                    if (peek(_M_bytes, off, bits) == pattern) {
+                        if (!all)
+                            return off;
+                        all->push_back(off);
+                    }
+                }
+                return npos;
+            }
+
+            // an occurrence at shift s within its first byte fully covers the
+            // next byte (the first one for s == 0), whose value is known:
+            // pattern bits [(8 - s) & 7, +8). shifts[b] is the set of shifts
+            // for which byte value b is that key.
+            std::uint8_t shifts[256] = { 0 };
+            byte keys[8];
+            std::size_t nkeys = 0;
+            for (std::size_t s = 0; s < 8; ++s) {
+                byte key = (pattern >> (bits - ((8 - s) & 0x7) - 8)) & 0xff;
+                if (shifts[key] == 0)
+                    keys[nkeys++] = key;
+                shifts[key] |= 1 << s;
+            }
+
+            // try the candidates whose key byte is k, in increasing bit
+            // offset (s == 8 stands for shift 0, which comes last); true once
+            // a match ends the search.
+            std::size_t found = npos;
+            auto candidates = [&](std::size_t k) -> bool {
+                unsigned m = shifts[_M_bytes[k]];
+                for (std::size_t s = 1; s <= 8; ++s) {
+                    if (!(m & (1 << (s & 0x7))) || (s < 8 && k == 0))
+                        continue;
+                    std::size_t off = s < 8 ? (k - 1) * 8 + s : k * 8;
+                    if (off < from || off > last || peek(_M_bytes, off, bits) != pattern)
+                        continue;
+                    if (!all) {
+                        found = off;
+                        return true;
+                    }
+                    all->push_back(off);
+                }
+                return false;
+            };
+
+#ifdef __SSE2__
+            if (simd_kernels_enabled()) {
+                __m128i vkeys[8];
+                for (std::size_t k = 0; k < nkeys; ++k)
+                    vkeys[k] = _mm_set1_epi8(static_cast<char>(keys[k]));
+                for (; i + 16 <= nbytes; i += 16) {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(_M_bytes + i));
+                    __m128i hit = _mm_cmpeq_epi8(x, vkeys[0]);
+                    for (std::size_t k = 1; k < nkeys; ++k)
+                        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(x, vkeys[k]));
+                    for (unsigned mask = _mm_movemask_epi8(hit); mask; mask &= mask - 1)
+                        if (candidates(i + __builtin_ctz(mask)))
+                            return found;
+                }
+            }
+#endif
+            for (; i < nbytes; ++i)
+                if (shifts[_M_bytes[i]] && candidates(i))
+                    return found;
+            return npos;
+        }
+
         std::ostream& operator << (std::ostream &os, ibitstream &ibs) {
             try {
                 while (true)
@@ -7,6 +7,10 @@
 #include <stdexcept>
 #include <ios>
 #include <iosfwd>
+#include <vector>
+
+#include "checksum.hpp"
+#include "simd.hpp"
 
 namespace org {
     namespace sqg {
@@ -18,6 +22,62 @@ namespace org {
                 bitstream_error(): runtime_error("insufficient memory for bitstream I/O") { }
         };
 
+        /**
+         * Hot-path counters of a single stream.
+         *
+         * The counters are only maintained when the library is configured with
+         * --enable-stats (BITSTREAM_STATS); otherwise they stay zero and the
+         * I/O paths carry no bookkeeping at all.
+         */
+        struct bitstream_stats {
+            enum width_bucket {
+                WIDTH_1 = 0,        // single bits
+                WIDTH_2_8,
+                WIDTH_9_16,
+                WIDTH_17_32,
+                WIDTH_33_64,
+                WIDTH_BUCKETS
+            };
+
+            std::uint64_t bits;                     // bits read or written
+            std::uint64_t calls[WIDTH_BUCKETS];     // operations by width
+            std::uint64_t aligned;                  // operations starting on a byte boundary
+            std::uint64_t unaligned;                // operations starting inside a byte
+            std::uint64_t growths;                  // buffer reallocations
+            std::uint64_t bytes_copied;             // bytes moved by reallocations
+            std::uint64_t overruns;                 // bitstream_error raised
+
+            bitstream_stats() { reset(); }
+
+            void reset();
+            bitstream_stats& operator += (bitstream_stats const&);
+
+            // whether the library was built with the counters compiled in.
+            static bool enabled();
+        };
+
+        /**
+         * Process-wide aggregate of stream counters. A stream adds its
+         * counters when it is destroyed or when publish_stats() is called on
+         * it; long-lived streams should publish periodically to be seen here.
+         * Safe to call from any thread.
+         */
+        extern bitstream_stats global_bitstream_stats();
+        extern void reset_global_bitstream_stats();
+
+        /**
+         * Tracing hook, called on the thread that hit the event with the bit
+         * position and, for an overrun, the bits requested or, for a growth,
+         * the bytes copied. Fired only in --enable-stats builds; the previous
+         * hook is returned, NULL removes it.
+         */
+        enum bitstream_event {
+            BITSTREAM_OVERRUN,
+            BITSTREAM_GROWTH,
+        };
+        typedef void (*bitstream_trace_hook)(bitstream_event, std::size_t, std::size_t);
+        extern bitstream_trace_hook set_bitstream_trace_hook(bitstream_trace_hook);
+
         class obitstream {
             public:
                 obitstream(std::shared_ptr<byte> const&, std::size_t);
@@ -33,6 +93,24 @@ namespace org {
                 void*       data();
                 void const* data() const;
                 std::size_t size() const;
+
+                bitstream_stats const& stats() const;
+                // add the counters so far to the global aggregate and restart them.
+                obitstream& publish_stats();
+
+                /**
+                 * Checksum every byte from the current one onwards while it
+                 * is written. Bytes are folded in once, when the position
+                 * first moves past them, so patching them later through
+                 * seek() is not reflected in the digest.
+                 */
+                obitstream& begin_checksum(checksum::algorithm, std::uint64_t seed = 0);
+                // digest of the bytes written so far, a trailing partial byte
+                // included with its unwritten bits taken as zero.
+                std::uint64_t digest() const;
+                // pad with zero bits to a byte boundary and append the digest;
+                // std::logic_error if no checksum was begun.
+                obitstream& write_digest();
             public:
                 static obitstream ref(void*, std::size_t);
                 template < typename T, size_t N >
@@ -60,6 +138,41 @@ namespace org {
                 std::size_t     read_bit();
             public:
                 ibitstream& seek(std::streamoff, std::ios::seekdir = std::ios::beg);
+                std::size_t tell() const { return _M_pos; }
+                std::size_t size() const { return _M_size; }
+
+                static std::size_t const npos = static_cast<std::size_t>(-1);
+
+                /**
+                 * Bit offset of the next occurrence of the low `bits` bits
+                 * (1 to 64) of pattern at or after `from`, npos if there is
+                 * none. The position of the stream is left alone.
+                 *
+                 * Patterns of 15 bits or more are located through a byte
+                 * prefilter, so start codes and sync words scan at close to
+                 * memory speed; shorter ones are tested at every offset.
+                 */
+                std::size_t find(std::uint64_t pattern, std::size_t bits, std::size_t from = 0) const;
+                // every occurrence, overlapping ones included, in increasing order.
+                std::vector<std::size_t> find_all(std::uint64_t pattern, std::size_t bits,
+                        std::size_t from = 0) const;
+
+                bitstream_stats const& stats() const { return _M_stats; }
+                ibitstream& publish_stats();
+
+                // counterparts of obitstream::begin_checksum() and friends.
+                ibitstream& begin_checksum(checksum::algorithm, std::uint64_t seed = 0);
+                std::uint64_t digest() const;
+                // skip the padding to a byte boundary, read the footer written
+                // by obitstream::write_digest() and check it; std::logic_error
+                // if no checksum was begun.
+                bool verify_digest();
+            private:
+                void require(std::size_t);
+                std::uint64_t read_uint0(std::size_t);
+                void fold();
+                std::size_t scan(std::uint64_t, std::size_t, std::size_t,
+                        std::vector<std::size_t>*) const;
             public:
                 static ibitstream ref(void const*, std::size_t);
                 template <typename T, std::size_t N>
@@ -73,10 +186,21 @@ namespace org {
                             size * 8);
                 }
             private:
+                // counters belong to the stream that did the I/O, so a copy
+                // starts from zero instead of being folded in twice.
+                struct counters : public bitstream_stats {
+                    counters() { }
+                    counters(counters const&) :bitstream_stats() { }
+                    counters& operator = (counters const&) { return *this; }
+                };
+
                 std::shared_ptr<byte const> _M_sptr;
                 byte const  *_M_bytes;
                 std::size_t _M_size;
                 std::size_t _M_pos;
+                counters    _M_stats;
+                checksum    _M_checksum;
+                std::size_t _M_digested;
 
                 friend std::ostream& operator << (std::ostream&, ibitstream&);
         };
@@ -0,0 +1,242 @@
+#include "checksum.hpp"
+#include "simd.hpp"
+
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#   define BITSTREAM_CRC32C_SSE42 1
+#   include <nmmintrin.h>
+#endif
+
+namespace {
+
+    std::uint32_t const CRC32C_POLY = 0x82f63b78;
+
+    std::uint64_t const XXH_P1 = 11400714785074694791ULL;
+    std::uint64_t const XXH_P2 = 14029467366897019727ULL;
+    std::uint64_t const XXH_P3 =  1609587929392839161ULL;
+    std::uint64_t const XXH_P4 =  9650029242287828579ULL;
+    std::uint64_t const XXH_P5 =  2870177450012600261ULL;
+
+    inline std::uint32_t load_le32(std::uint8_t const *p) {
+        return static_cast<std::uint32_t>(p[0])
+            | (static_cast<std::uint32_t>(p[1]) << 8)
+            | (static_cast<std::uint32_t>(p[2]) << 16)
+            | (static_cast<std::uint32_t>(p[3]) << 24);
+    }
+
+    inline std::uint64_t load_le64(std::uint8_t const *p) {
+        return static_cast<std::uint64_t>(load_le32(p))
+            | (static_cast<std::uint64_t>(load_le32(p + 4)) << 32);
+    }
+
+    inline std::uint64_t rotl64(std::uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // slice-by-8 lookup tables for the portable CRC32C path.
+    struct crc32c_tables {
+        std::uint32_t t[8][256];
+
+        crc32c_tables() {
+            for (std::uint32_t i = 0; i < 256; ++i) {
+                std::uint32_t c = i;
+                for (int k = 0; k < 8; ++k)
+                    c = (c >> 1) ^ ((c & 0x1) ? CRC32C_POLY : 0);
+                t[0][i] = c;
+            }
+            for (std::size_t i = 0; i < 256; ++i)
+                for (std::size_t k = 1; k < 8; ++k)
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+        }
+    };
+
+    crc32c_tables const CRC32C_TABLES;
+
+    std::uint32_t crc32c_sw(std::uint32_t crc, std::uint8_t const *p, std::size_t n) {
+        std::uint32_t const (&t)[8][256] = CRC32C_TABLES.t;
+        while (n >= 8) {
+            std::uint32_t lo = crc ^ load_le32(p);
+            std::uint32_t hi = load_le32(p + 4);
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff]
+                ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+                ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff]
+                ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            p += 8;
+            n -= 8;
+        }
+        while (n-- > 0)
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+        return crc;
+    }
+
+#ifdef BITSTREAM_CRC32C_SSE42
+    __attribute__((target("sse4.2")))
+    std::uint32_t crc32c_hw(std::uint32_t crc, std::uint8_t const *p, std::size_t n) {
+#   ifdef __x86_64__
+        std::uint64_t c = crc;
+        while (n >= 8) {
+            std::uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            c = _mm_crc32_u64(c, v);
+            p += 8;
+            n -= 8;
+        }
+        crc = static_cast<std::uint32_t>(c);
+#   endif
+        while (n >= 4) {
+            std::uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            crc = _mm_crc32_u32(crc, v);
+            p += 4;
+            n -= 4;
+        }
+        while (n-- > 0)
+            crc = _mm_crc32_u8(crc, *p++);
+        return crc;
+    }
+
+    bool detect_sse42() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+    }
+
+    bool const HAS_SSE42 = detect_sse42();
+#endif
+
+    std::uint32_t crc32c(std::uint32_t crc, std::uint8_t const *p, std::size_t n) {
+#ifdef BITSTREAM_CRC32C_SSE42
+        if (HAS_SSE42 && org::sqg::simd_kernels_enabled())
+            return crc32c_hw(crc, p, n);
+#endif
+        return crc32c_sw(crc, p, n);
+    }
+
+    inline std::uint64_t xxh64_round(std::uint64_t acc, std::uint64_t input) {
+        acc += input * XXH_P2;
+        acc = rotl64(acc, 31);
+        return acc * XXH_P1;
+    }
+
+    inline std::uint64_t xxh64_merge(std::uint64_t acc, std::uint64_t val) {
+        acc ^= xxh64_round(0, val);
+        return acc * XXH_P1 + XXH_P4;
+    }
+
+    inline void xxh64_stripe(std::uint64_t (&acc)[4], std::uint8_t const *p) {
+        acc[0] = xxh64_round(acc[0], load_le64(p));
+        acc[1] = xxh64_round(acc[1], load_le64(p + 8));
+        acc[2] = xxh64_round(acc[2], load_le64(p + 16));
+        acc[3] = xxh64_round(acc[3], load_le64(p + 24));
+    }
+}
+
+namespace org {
+    namespace sqg {
+
+        checksum::checksum(algorithm algo, std::uint64_t seed)
+            :_M_algorithm(algo),
+            _M_seed(seed)
+        {
+            reset();
+        }
+
+        void checksum::reset() {
+            _M_length = 0;
+            _M_crc = ~static_cast<std::uint32_t>(_M_seed);
+            _M_acc[0] = _M_seed + XXH_P1 + XXH_P2;
+            _M_acc[1] = _M_seed + XXH_P2;
+            _M_acc[2] = _M_seed;
+            _M_acc[3] = _M_seed - XXH_P1;
+            _M_buffered = 0;
+        }
+
+        std::size_t checksum::bits() const {
+            switch (_M_algorithm) {
+                case CRC32C:   return 32;
+                case XXHASH64: return 64;
+                default:       return 0;
+            }
+        }
+
+        checksum& checksum::update(void const *mem, std::size_t n) {
+            std::uint8_t const *p = static_cast<std::uint8_t const*>(mem);
+            switch (_M_algorithm) {
+                case CRC32C:
+                    _M_crc = crc32c(_M_crc, p, n);
+                    break;
+                case XXHASH64:
+                    _M_length += n;
+                    if (_M_buffered + n < sizeof(_M_buffer)) {
+                        std::memcpy(_M_buffer + _M_buffered, p, n);
+                        _M_buffered += n;
+                        break;
+                    }
+                    if (_M_buffered > 0) {
+                        std::size_t fill = sizeof(_M_buffer) - _M_buffered;
+                        std::memcpy(_M_buffer + _M_buffered, p, fill);
+                        xxh64_stripe(_M_acc, _M_buffer);
+                        p += fill;
+                        n -= fill;
+                        _M_buffered = 0;
+                    }
+                    while (n >= sizeof(_M_buffer)) {
+                        xxh64_stripe(_M_acc, p);
+                        p += sizeof(_M_buffer);
+                        n -= sizeof(_M_buffer);
+                    }
+                    std::memcpy(_M_buffer, p, n);
+                    _M_buffered = n;
+                    break;
+                default: break;
+            }
+            return *this;
+        }
+
+        std::uint64_t checksum::digest() const {
+            if (_M_algorithm == CRC32C)
+                return ~_M_crc;
+            if (_M_algorithm != XXHASH64)
+                return 0;
+
+            std::uint64_t h = 0;
+            if (_M_length >= sizeof(_M_buffer)) {
+                h = rotl64(_M_acc[0], 1) + rotl64(_M_acc[1], 7)
+                    + rotl64(_M_acc[2], 12) + rotl64(_M_acc[3], 18);
+                h = xxh64_merge(h, _M_acc[0]);
+                h = xxh64_merge(h, _M_acc[1]);
+                h = xxh64_merge(h, _M_acc[2]);
+                h = xxh64_merge(h, _M_acc[3]);
+            } else {
+                h = _M_seed + XXH_P5;
+            }
+            h += _M_length;
+
+            std::uint8_t const *p = _M_buffer;
+            std::size_t n = _M_buffered;
+            while (n >= 8) {
+                h ^= xxh64_round(0, load_le64(p));
+                h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+                p += 8;
+                n -= 8;
+            }
+            if (n >= 4) {
+                h ^= static_cast<std::uint64_t>(load_le32(p)) * XXH_P1;
+                h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+                p += 4;
+                n -= 4;
+            }
+            while (n-- > 0) {
+                h ^= (*p++) * XXH_P5;
+                h = rotl64(h, 11) * XXH_P1;
+            }
+
+            h ^= h >> 33;
+            h *= XXH_P2;
+            h ^= h >> 29;
+            h *= XXH_P3;
+            h ^= h >> 32;
+            return h;
+        }
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef BITSTREAM_CHECKSUM_HPP_INCLUDED
+#define BITSTREAM_CHECKSUM_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace org {
+    namespace sqg {
+
+        /**
+         * Incremental frame checksum.
+         *
+         * Bytes may be fed in pieces of any size; digest() does not disturb
+         * the running state, so it may be taken at any point and feeding may
+         * continue afterwards.
+         */
+        class checksum {
+            public:
+                enum algorithm {
+                    NONE = 0,
+                    CRC32C,     // Castagnoli CRC, SSE4.2 when available
+                    XXHASH64,   // xxHash64
+                };
+            public:
+                explicit checksum(algorithm = NONE, std::uint64_t seed = 0);
+            public:
+                checksum&       update(void const*, std::size_t);
+                std::uint64_t   digest() const;
+                void            reset();
+
+                algorithm       type() const { return _M_algorithm; }
+                bool            enabled() const { return _M_algorithm != NONE; }
+                // width in bits of the digest as stored in a frame footer.
+                std::size_t     bits() const;
+            private:
+                algorithm       _M_algorithm;
+                std::uint64_t   _M_seed;
+                std::uint64_t   _M_length;
+                std::uint32_t   _M_crc;
+                std::uint64_t   _M_acc[4];
+                std::uint8_t    _M_buffer[32];
+                std::size_t     _M_buffered;
+        };
+    }
+}
+
+#endif // BITSTREAM_CHECKSUM_HPP_INCLUDED
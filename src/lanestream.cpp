@@ -0,0 +1,347 @@
+#include "lanestream.hpp"
+#include "simd.hpp"
+
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#   define BITSTREAM_LANES_AVX2 1
+#   include <immintrin.h>
+#endif
+
+namespace {
+
+    struct no_delete {
+        void operator () (void const*) { }
+    };
+
+    inline std::uint32_t load_be32(org::sqg::byte const *p) {
+        return (static_cast<std::uint32_t>(p[0]) << 24)
+            | (static_cast<std::uint32_t>(p[1]) << 16)
+            | (static_cast<std::uint32_t>(p[2]) << 8)
+            | static_cast<std::uint32_t>(p[3]);
+    }
+
+    inline void store_be32(org::sqg::byte *p, std::uint32_t v) {
+        p[0] = v >> 24;
+        p[1] = v >> 16;
+        p[2] = v >> 8;
+        p[3] = v;
+    }
+
+    std::size_t lanes_shift(std::size_t lanes) {
+        switch (lanes) {
+            case 4:  return 2;
+            case 8:  return 3;
+            case 16: return 4;
+            default: throw std::invalid_argument("lane count must be 4, 8 or 16");
+        }
+    }
+
+    // lane positions and word indices are 32-bit so that a vector register
+    // holds a whole group; this caps a lane at 256 MiB.
+    std::size_t const MAX_ROWS = (1 << 26) - 1;
+
+    bool read_scalar(org::sqg::byte const *bytes, std::size_t lanes, std::size_t rows,
+            std::uint32_t *pos, std::uint8_t const *widths, std::size_t bits,
+            std::uint32_t *out) {
+        std::uint64_t const limit = static_cast<std::uint64_t>(rows) * 32;
+        for (std::size_t i = 0; i < lanes; ++i) {
+            std::size_t w = widths ? widths[i] : bits;
+            if (w > 32 || pos[i] + w > limit)
+                return false;
+        }
+        for (std::size_t i = 0; i < lanes; ++i) {
+            std::size_t w = widths ? widths[i] : bits;
+            if (w == 0) {
+                // the lane may be used up, do not touch its words.
+                out[i] = 0;
+                continue;
+            }
+            std::size_t p = pos[i];
+            std::size_t j = p >> 5;
+            std::uint64_t v = static_cast<std::uint64_t>(load_be32(bytes + (j * lanes + i) * 4)) << 32;
+            if (j + 1 < rows)
+                v |= load_be32(bytes + ((j + 1) * lanes + i) * 4);
+            out[i] = static_cast<std::uint32_t>((v << (p & 31)) >> (64 - w));
+            pos[i] = p + w;
+        }
+        return true;
+    }
+
+#ifdef BITSTREAM_LANES_AVX2
+    __attribute__((target("avx2")))
+    bool read_avx2_x4(org::sqg::byte const *bytes, std::size_t rows,
+            std::uint32_t *pos, std::uint8_t const *widths, std::size_t bits,
+            std::uint32_t *out) {
+        int const *base = reinterpret_cast<int const*>(bytes);
+        __m128i const bswap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        __m128i const c32 = _mm_set1_epi32(32);
+
+        __m128i p = _mm_loadu_si128(reinterpret_cast<__m128i const*>(pos));
+        __m128i w = _mm_set1_epi32(bits);
+        if (widths) {
+            int packed;
+            std::memcpy(&packed, widths, sizeof(packed));
+            w = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed));
+        }
+        __m128i end = _mm_add_epi32(p, w);
+        __m128i limit = _mm_set1_epi32(static_cast<int>(rows * 32));
+        __m128i ok = _mm_and_si128(
+                _mm_cmpeq_epi32(_mm_min_epu32(end, limit), end),
+                _mm_cmpeq_epi32(_mm_min_epu32(w, c32), w));
+        if (_mm_movemask_epi8(ok) != 0xffff)
+            return false;
+
+        __m128i j = _mm_srli_epi32(p, 5);
+        __m128i o = _mm_and_si128(p, _mm_set1_epi32(31));
+        __m128i idx = _mm_add_epi32(_mm_slli_epi32(j, 2), _mm_setr_epi32(0, 1, 2, 3));
+        // zero-width lanes may sit at the very end, load nothing for them.
+        __m128i live = _mm_andnot_si128(_mm_cmpeq_epi32(w, _mm_setzero_si128()), _mm_set1_epi32(-1));
+        __m128i has_lo = _mm_and_si128(live, _mm_cmpgt_epi32(_mm_set1_epi32(static_cast<int>(rows)),
+                _mm_add_epi32(j, _mm_set1_epi32(1))));
+        __m128i hi = _mm_mask_i32gather_epi32(_mm_setzero_si128(), base, idx, live, 4);
+        __m128i lo = _mm_mask_i32gather_epi32(_mm_setzero_si128(), base,
+                _mm_add_epi32(idx, _mm_set1_epi32(4)), has_lo, 4);
+        hi = _mm_shuffle_epi8(hi, bswap);
+        lo = _mm_shuffle_epi8(lo, bswap);
+        __m128i v = _mm_or_si128(_mm_sllv_epi32(hi, o), _mm_srlv_epi32(lo, _mm_sub_epi32(c32, o)));
+        v = _mm_srlv_epi32(v, _mm_sub_epi32(c32, w));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pos), end);
+        return true;
+    }
+
+    __attribute__((target("avx2")))
+    bool read_avx2_x8(org::sqg::byte const *bytes, std::size_t lanes, std::size_t rows,
+            std::uint32_t *pos, std::uint8_t const *widths, std::size_t bits,
+            std::uint32_t *out) {
+        int const *base = reinterpret_cast<int const*>(bytes);
+        __m256i const bswap = _mm256_setr_epi8(
+                3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+        __m256i const c32 = _mm256_set1_epi32(32);
+        __m256i const limit = _mm256_set1_epi32(static_cast<int>(rows * 32));
+        __m128i const shift = _mm_cvtsi32_si128(static_cast<int>(lanes_shift(lanes)));
+
+        // validate every group before any position moves.
+        __m256i ok = _mm256_set1_epi32(-1);
+        for (std::size_t b = 0; b < lanes; b += 8) {
+            __m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pos + b));
+            __m256i w = widths
+                ? _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(widths + b)))
+                : _mm256_set1_epi32(bits);
+            __m256i end = _mm256_add_epi32(p, w);
+            ok = _mm256_and_si256(ok, _mm256_and_si256(
+                        _mm256_cmpeq_epi32(_mm256_min_epu32(end, limit), end),
+                        _mm256_cmpeq_epi32(_mm256_min_epu32(w, c32), w)));
+        }
+        if (_mm256_movemask_epi8(ok) != -1)
+            return false;
+
+        for (std::size_t b = 0; b < lanes; b += 8) {
+            __m256i p = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(pos + b));
+            __m256i w = widths
+                ? _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(widths + b)))
+                : _mm256_set1_epi32(bits);
+            __m256i j = _mm256_srli_epi32(p, 5);
+            __m256i o = _mm256_and_si256(p, _mm256_set1_epi32(31));
+            __m256i idx = _mm256_add_epi32(_mm256_sll_epi32(j, shift),
+                    _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(b)),
+                        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+            // zero-width lanes may sit at the very end, load nothing for them.
+            __m256i live = _mm256_andnot_si256(_mm256_cmpeq_epi32(w, _mm256_setzero_si256()),
+                    _mm256_set1_epi32(-1));
+            __m256i has_lo = _mm256_and_si256(live, _mm256_cmpgt_epi32(
+                        _mm256_set1_epi32(static_cast<int>(rows)),
+                        _mm256_add_epi32(j, _mm256_set1_epi32(1))));
+            __m256i hi = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, idx, live, 4);
+            __m256i lo = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base,
+                    _mm256_add_epi32(idx, _mm256_set1_epi32(static_cast<int>(lanes))), has_lo, 4);
+            hi = _mm256_shuffle_epi8(hi, bswap);
+            lo = _mm256_shuffle_epi8(lo, bswap);
+            __m256i v = _mm256_or_si256(_mm256_sllv_epi32(hi, o),
+                    _mm256_srlv_epi32(lo, _mm256_sub_epi32(c32, o)));
+            v = _mm256_srlv_epi32(v, _mm256_sub_epi32(c32, w));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + b), v);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pos + b), _mm256_add_epi32(p, w));
+        }
+        return true;
+    }
+
+    bool detect_avx2() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }
+
+    bool const HAS_AVX2 = detect_avx2();
+#endif
+}
+
+namespace org {
+    namespace sqg {
+
+        olanestream::olanestream(std::size_t lanes)
+            :_M_lanes(lanes),
+            _M_lane(0),
+            _M_pos(lanes, 0)
+        {
+            lanes_shift(lanes);
+        }
+
+        std::size_t olanestream::rows() const {
+            return _M_data.size() / (_M_lanes * 4);
+        }
+
+        void const* olanestream::data() const {
+            return _M_data.empty() ? NULL : &_M_data[0];
+        }
+
+        std::size_t olanestream::size() const {
+            return _M_data.size();
+        }
+
+        olanestream& olanestream::write_uint(std::uint32_t value, std::size_t bits) {
+            if (bits > 32)
+                throw std::invalid_argument("lane fields are at most 32 bits");
+            if (bits == 0)
+                return *this;
+            std::size_t p = _M_pos[_M_lane];
+            std::size_t need = (p + bits + 31) >> 5;
+            if (need > MAX_ROWS)
+                throw bitstream_error();
+            while (rows() < need)
+                _M_data.resize(_M_data.size() + _M_lanes * 4, 0);
+
+            std::size_t j = p >> 5;
+            std::size_t o = p & 31;
+            std::uint64_t v = static_cast<std::uint64_t>(value) << (64 - bits);
+            v >>= o;
+            byte *w = &_M_data[(j * _M_lanes + _M_lane) * 4];
+            store_be32(w, load_be32(w) | static_cast<std::uint32_t>(v >> 32));
+            if (o + bits > 32) {
+                w += _M_lanes * 4;
+                store_be32(w, load_be32(w) | static_cast<std::uint32_t>(v));
+            }
+            _M_pos[_M_lane] = p + bits;
+            return *this;
+        }
+
+        olanestream& olanestream::next() {
+            _M_lane = (_M_lane + 1) & (_M_lanes - 1);
+            return *this;
+        }
+
+        olanestream& olanestream::write_records(ibitstream &plain,
+                std::vector<std::size_t> const &lengths) {
+            for (std::size_t i = 0; i < lengths.size(); ++i) {
+                for (std::size_t bits = lengths[i]; bits > 0; ) {
+                    std::size_t n = bits < 32 ? bits : 32;
+                    write_uint(plain.read_uint(n), n);
+                    bits -= n;
+                }
+                next();
+            }
+            return *this;
+        }
+
+        obitstream& olanestream::write_to(obitstream &obs) const {
+            obs.write_uint(_M_lanes, 8);
+            obs.write_uint(rows(), 32);
+            for (std::size_t i = 0; i < _M_data.size(); i += 4)
+                obs.write_uint(load_be32(&_M_data[i]), 32);
+            return obs;
+        }
+
+        ilanestream::ilanestream(
+                std::shared_ptr<byte const> const &mem,
+                std::size_t size,
+                std::size_t lanes)
+            :_M_sptr(mem),
+            _M_bytes(mem.get()),
+            _M_lanes(lanes),
+            _M_rows(size / (std::size_t(4) << lanes_shift(lanes))),
+            _M_pos(lanes, 0)
+        {
+            if (_M_rows > MAX_ROWS)
+                throw std::invalid_argument("lane too long for 32-bit positions");
+        }
+
+        ilanestream& ilanestream::read_uint(std::size_t bits, std::uint32_t *out) {
+            read0(NULL, bits, out);
+            return *this;
+        }
+
+        ilanestream& ilanestream::read_uints(std::uint8_t const *bits, std::uint32_t *out) {
+            read0(bits, 0, out);
+            return *this;
+        }
+
+        void ilanestream::read0(std::uint8_t const *widths, std::size_t bits, std::uint32_t *out) {
+            bool ok = false;
+            // the vector kernels only see the low 32 bits of the width.
+            if (bits > 32)
+                throw bitstream_error();
+#ifdef BITSTREAM_LANES_AVX2
+            if (HAS_AVX2 && simd_kernels_enabled()) {
+                if (_M_lanes == 4)
+                    ok = read_avx2_x4(_M_bytes, _M_rows, &_M_pos[0], widths, bits, out);
+                else
+                    ok = read_avx2_x8(_M_bytes, _M_lanes, _M_rows, &_M_pos[0], widths, bits, out);
+            } else
+#endif
+            ok = read_scalar(_M_bytes, _M_lanes, _M_rows, &_M_pos[0], widths, bits, out);
+            if (!ok)
+                throw bitstream_error();
+        }
+
+        std::uint32_t ilanestream::read_lane(std::size_t lane, std::size_t bits) {
+            if (lane >= _M_lanes || bits > 32
+                    || _M_pos[lane] + bits > static_cast<std::uint64_t>(_M_rows) * 32)
+                throw bitstream_error();
+            if (bits == 0)
+                return 0;
+            std::size_t p = _M_pos[lane];
+            std::size_t j = p >> 5;
+            std::uint64_t v = static_cast<std::uint64_t>(load_be32(_M_bytes + (j * _M_lanes + lane) * 4)) << 32;
+            if (j + 1 < _M_rows)
+                v |= load_be32(_M_bytes + ((j + 1) * _M_lanes + lane) * 4);
+            _M_pos[lane] = p + bits;
+            return static_cast<std::uint32_t>((v << (p & 31)) >> (64 - bits));
+        }
+
+        obitstream& ilanestream::read_records(obitstream &plain,
+                std::vector<std::size_t> const &lengths) {
+            for (std::size_t i = 0; i < lengths.size(); ++i) {
+                std::size_t lane = i & (_M_lanes - 1);
+                for (std::size_t bits = lengths[i]; bits > 0; ) {
+                    std::size_t n = bits < 32 ? bits : 32;
+                    plain.write_uint(read_lane(lane, n), n);
+                    bits -= n;
+                }
+            }
+            return plain;
+        }
+
+        ilanestream ilanestream::ref(void const *mem, std::size_t size, std::size_t lanes) {
+            return ilanestream(
+                    std::shared_ptr<byte const>(static_cast<byte const*>(mem), no_delete()),
+                    size, lanes);
+        }
+
+        ilanestream ilanestream::read_from(ibitstream &ibs) {
+            std::size_t lanes = ibs.read_uint(8);
+            std::size_t rows = ibs.read_uint(32);
+            lanes_shift(lanes);
+            if (rows > MAX_ROWS)
+                throw std::invalid_argument("lane too long for 32-bit positions");
+            std::size_t size = rows * lanes * 4;
+            // a corrupt header must not size the allocation.
+            if (size * 8 > ibs.size() - ibs.tell())
+                throw bitstream_error();
+            std::shared_ptr<byte> mem(new byte[size ? size : 1], std::default_delete<byte[]>());
+            for (std::size_t i = 0; i < size; i += 4)
+                store_be32(mem.get() + i, ibs.read_uint(32));
+            return ilanestream(mem, size, lanes);
+        }
+    }
+}
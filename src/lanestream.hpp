@@ -0,0 +1,94 @@
+#ifndef BITSTREAM_LANESTREAM_HPP_INCLUDED
+#define BITSTREAM_LANESTREAM_HPP_INCLUDED
+
+#include "bitstream.hpp"
+
+#include <vector>
+
+namespace org {
+    namespace sqg {
+
+        /**
+         * Multi-lane bitstreams.
+         *
+         * Records are distributed round-robin over 4, 8 or 16 independent
+         * lanes. Each lane is an MSB-first bitstream cut into 32-bit words,
+         * and the lanes are interleaved word by word: word j of lane l is
+         * stored big-endian at word index j * lanes + l. The whole buffer is
+         * therefore itself a plain MSB-first bitstream, and since every lane
+         * has its own position a reader can decode one field of all lanes at
+         * once.
+         */
+        class olanestream {
+            public:
+                explicit olanestream(std::size_t lanes);
+            public:
+                // append to the current lane, at most 32 bits.
+                olanestream& write_uint(std::uint32_t, std::size_t);
+                // the current record is complete, move on to the next lane.
+                olanestream& next();
+
+                std::size_t lanes() const { return _M_lanes; }
+                std::size_t lane() const { return _M_lane; }
+                std::size_t rows() const;
+
+                void const* data() const;
+                std::size_t size() const;
+
+                /**
+                 * Interleave a plain record-order payload: record i, of
+                 * lengths[i] bits, is copied from the stream into the current
+                 * lane, which then moves on as with next().
+                 */
+                olanestream& write_records(ibitstream&, std::vector<std::size_t> const &lengths);
+
+                // frame the interleaved words themselves into a plain stream:
+                // lane count (8 bits), row count (32 bits), then the words.
+                obitstream& write_to(obitstream&) const;
+            private:
+                std::size_t                 _M_lanes;
+                std::size_t                 _M_lane;
+                std::vector<std::size_t>    _M_pos;
+                std::vector<byte>           _M_data;
+        };
+
+        class ilanestream {
+            public:
+                // unlike ibitstream's, the size here is in bytes, as for ref().
+                ilanestream(std::shared_ptr<byte const> const&, std::size_t bytes, std::size_t lanes);
+            public:
+                /**
+                 * Read one field from every lane, the value of lane i going to
+                 * out[i]. read_uints() takes a width per lane.
+                 */
+                ilanestream& read_uint(std::size_t bits, std::uint32_t *out);
+                ilanestream& read_uints(std::uint8_t const *bits, std::uint32_t *out);
+                // read from a single lane only.
+                std::uint32_t read_lane(std::size_t lane, std::size_t bits);
+                /**
+                 * De-interleave back to record order: record i, of
+                 * lengths[i] bits, is read from lane i % lanes() and
+                 * appended to the plain stream.
+                 */
+                obitstream& read_records(obitstream&, std::vector<std::size_t> const &lengths);
+
+                std::size_t lanes() const { return _M_lanes; }
+                std::size_t rows() const { return _M_rows; }
+            public:
+                static ilanestream ref(void const*, std::size_t, std::size_t lanes);
+                // counterpart of olanestream::write_to(), copies the words out;
+                // bitstream_error if the stream is shorter than its header says.
+                static ilanestream read_from(ibitstream&);
+            private:
+                void read0(std::uint8_t const*, std::size_t, std::uint32_t*);
+            private:
+                std::shared_ptr<byte const> _M_sptr;
+                byte const                  *_M_bytes;
+                std::size_t                 _M_lanes;
+                std::size_t                 _M_rows;
+                std::vector<std::uint32_t>  _M_pos;
+        };
+    }
+}
+
+#endif // BITSTREAM_LANESTREAM_HPP_INCLUDED
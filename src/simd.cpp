@@ -0,0 +1,19 @@
+#include "simd.hpp"
+
+namespace {
+
+    bool SIMD_KERNELS = true;
+}
+
+namespace org {
+    namespace sqg {
+
+        void enable_simd_kernels(bool on) {
+            SIMD_KERNELS = on;
+        }
+
+        bool simd_kernels_enabled() {
+            return SIMD_KERNELS;
+        }
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef BITSTREAM_SIMD_HPP_INCLUDED
+#define BITSTREAM_SIMD_HPP_INCLUDED
+
+namespace org {
+    namespace sqg {
+
+        /**
+         * Whether the SIMD kernels detected at run time may be used. Turning
+         * them off forces the portable fallbacks, which is mainly useful for
+         * testing those on capable hosts. Set it before streams are in use.
+         */
+        extern void enable_simd_kernels(bool);
+        extern bool simd_kernels_enabled();
+    }
+}
+
+#endif // BITSTREAM_SIMD_HPP_INCLUDED
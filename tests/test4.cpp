@@ -0,0 +1,118 @@
+#include "../src/bitstream.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            std::cerr << #CONDITION << " failed!" << std::endl; \
+            return EXIT_FAILURE; \
+        } \
+    } while (0)
+
+static std::size_t traced[2];
+
+static void trace(org::sqg::bitstream_event event, std::size_t pos, std::size_t value) {
+    ++traced[event];
+}
+
+int main(int argc, char* argv[]) {
+    using namespace std;
+    using namespace org::sqg;
+
+    unsigned char buf[4];
+
+    reset_global_bitstream_stats();
+    TEST_ASSERT(set_bitstream_trace_hook(&trace) == NULL);
+    {
+        obitstream obs = obitstream::ref(&buf[0], sizeof(buf));
+        ibitstream ibs = ibitstream::ref(buf);
+        obs.write_bit(1);
+        obs.write_uint(0x5a, 7);
+        obs.write_uint(0x1234, 16);
+        TEST_ASSERT(ibs.read_uint(8) == 0xda);
+        TEST_ASSERT(ibs.read_uint(16) == 0x1234);
+        TEST_ASSERT(ibs.read_bit() == 0);
+        try {
+            ibs.read_uint(8);
+            TEST_ASSERT(false);
+        } catch (bitstream_error const &e) {
+        }
+
+        bitstream_stats const &os = obs.stats();
+        bitstream_stats const &is = ibs.stats();
+        if (bitstream_stats::enabled()) {
+            TEST_ASSERT(os.bits == 24);
+            TEST_ASSERT(os.calls[bitstream_stats::WIDTH_1] == 1);
+            TEST_ASSERT(os.calls[bitstream_stats::WIDTH_2_8] == 1);
+            TEST_ASSERT(os.calls[bitstream_stats::WIDTH_9_16] == 1);
+            TEST_ASSERT(os.aligned == 2);
+            TEST_ASSERT(os.unaligned == 1);
+            TEST_ASSERT(is.bits == 25);
+            TEST_ASSERT(is.aligned == 3);
+            TEST_ASSERT(is.unaligned == 0);
+            TEST_ASSERT(is.overruns == 1);
+        } else {
+            TEST_ASSERT(os.bits == 0);
+            TEST_ASSERT(is.bits == 0);
+            TEST_ASSERT(is.overruns == 0);
+        }
+    }
+    {
+        obitstream obs(std::shared_ptr<byte>(), 0);
+        for (size_t i = 0; i < 64; ++i)
+            obs.write_uint(i, 8);
+        if (bitstream_stats::enabled()) {
+            TEST_ASSERT(obs.stats().growths > 0);
+            TEST_ASSERT(obs.stats().bytes_copied > 0);
+        }
+    }
+
+    bitstream_stats total = global_bitstream_stats();
+    if (bitstream_stats::enabled()) {
+        TEST_ASSERT(total.bits == 24 + 25 + 64 * 8);
+        TEST_ASSERT(total.overruns == 1);
+        TEST_ASSERT(traced[BITSTREAM_OVERRUN] == 1);
+        TEST_ASSERT(traced[BITSTREAM_GROWTH] == total.growths);
+    } else {
+        TEST_ASSERT(total.bits == 0);
+        TEST_ASSERT(traced[BITSTREAM_OVERRUN] == 0);
+        TEST_ASSERT(traced[BITSTREAM_GROWTH] == 0);
+    }
+    TEST_ASSERT(set_bitstream_trace_hook(NULL) == &trace);
+
+    // signed fields count as one call on both sides.
+    {
+        obitstream obs = obitstream::ref(&buf[0], sizeof(buf));
+        ibitstream ibs = ibitstream::ref(buf);
+        obs.write_int(-3, 6);
+        obs.write_intS(-3, 6);
+        obs.write_int(0, 1);
+        TEST_ASSERT(ibs.read_int(6) == -3);
+        TEST_ASSERT(ibs.read_intS(6) == -3);
+        TEST_ASSERT(ibs.read_int(1) == 0);
+        bitstream_stats const &os = obs.stats();
+        bitstream_stats const &is = ibs.stats();
+        for (size_t i = 0; i < bitstream_stats::WIDTH_BUCKETS; ++i)
+            TEST_ASSERT(os.calls[i] == is.calls[i]);
+        TEST_ASSERT(os.bits == is.bits);
+        TEST_ASSERT(os.aligned == is.aligned);
+        TEST_ASSERT(os.unaligned == is.unaligned);
+        if (bitstream_stats::enabled()) {
+            TEST_ASSERT(is.calls[bitstream_stats::WIDTH_1] == 1);
+            TEST_ASSERT(is.calls[bitstream_stats::WIDTH_2_8] == 2);
+        }
+
+        // a live stream shows up in the aggregate once it publishes.
+        reset_global_bitstream_stats();
+        ibs.publish_stats();
+        TEST_ASSERT(ibs.stats().bits == 0);
+        TEST_ASSERT(global_bitstream_stats().bits == (bitstream_stats::enabled() ? 13 : 0));
+        obs.publish_stats();
+        TEST_ASSERT(obs.stats().bits == 0);
+        TEST_ASSERT(global_bitstream_stats().bits == (bitstream_stats::enabled() ? 26 : 0));
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+#include "../src/bitstream.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            std::cerr << #CONDITION << " failed!" << std::endl; \
+            return EXIT_FAILURE; \
+        } \
+    } while (0)
+
+static int test_checksums() {
+    using namespace std;
+    using namespace org::sqg;
+
+    byte seq[100];
+    for (size_t i = 0; i < sizeof(seq); ++i)
+        seq[i] = i;
+
+    TEST_ASSERT(checksum(checksum::CRC32C).update("123456789", 9).digest() == 0xe3069283);
+    TEST_ASSERT(checksum(checksum::XXHASH64).digest() == 0xef46db3751d8e999ULL);
+    TEST_ASSERT(checksum(checksum::XXHASH64).update("abc", 3).digest() == 0x44bc2cf5ad770999ULL);
+
+    // uneven pieces must give the same digest as a single pass.
+    checksum crc(checksum::CRC32C);
+    checksum xxh(checksum::XXHASH64);
+    for (size_t off = 0, n = 1; off < sizeof(seq); off += n, n += 3) {
+        if (off + n > sizeof(seq))
+            n = sizeof(seq) - off;
+        crc.update(seq + off, n);
+        xxh.update(seq + off, n);
+    }
+    TEST_ASSERT(crc.digest() == 0xc1caebe5);
+    TEST_ASSERT(xxh.digest() == 0x6ac1e58032166597ULL);
+
+    checksum::algorithm const algos[] = { checksum::CRC32C, checksum::XXHASH64 };
+    for (size_t a = 0; a < sizeof(algos) / sizeof(algos[0]); ++a) {
+        byte buf[0x100] = { 0 };
+
+        obitstream obs = obitstream::ref(&buf[0], sizeof(buf));
+        obs.write_uint(0x3, 2);
+        obs.begin_checksum(algos[a]);
+        for (size_t i = 0; i < 50; ++i)
+            obs.write_uint(i, 13);
+        obs.write_intS(-5, 7);
+        uint64_t d = obs.digest();
+        obs.write_digest();
+
+        ibitstream ibs = ibitstream::ref(buf);
+        TEST_ASSERT(ibs.read_uint(2) == 0x3);
+        ibs.begin_checksum(algos[a]);
+        for (size_t i = 0; i < 50; ++i)
+            TEST_ASSERT(ibs.read_uint(13) == i);
+        TEST_ASSERT(ibs.read_intS(7) == -5);
+        TEST_ASSERT(ibs.digest() == d);
+        TEST_ASSERT(ibs.verify_digest());
+
+        // a flipped payload bit must be caught.
+        buf[7] ^= 0x10;
+        ibitstream bad = ibitstream::ref(buf);
+        bad.read_uint(2);
+        bad.begin_checksum(algos[a]);
+        for (size_t i = 0; i < 50; ++i)
+            bad.read_uint(13);
+        bad.read_intS(7);
+        TEST_ASSERT(!bad.verify_digest());
+    }
+
+    // the digest ignores stale bits behind the position.
+    byte reused[16];
+    for (size_t i = 0; i < sizeof(reused); ++i)
+        reused[i] = 0xff;
+    obitstream obs = obitstream::ref(&reused[0], sizeof(reused));
+    obs.begin_checksum(checksum::CRC32C);
+    obs.write_uint(0x5, 11);
+    uint64_t d = obs.digest();
+    obs.write_digest();
+    ibitstream ibs = ibitstream::ref(reused);
+    ibs.begin_checksum(checksum::CRC32C);
+    TEST_ASSERT(ibs.read_uint(11) == 0x5);
+    TEST_ASSERT(ibs.digest() == d);
+    TEST_ASSERT(ibs.read_uint(5) == 0);
+    TEST_ASSERT(ibs.read_uint(32) == d);
+
+    // a footer needs a checksum to have been begun.
+    ibitstream plain = ibitstream::ref(reused);
+    try {
+        plain.verify_digest();
+        TEST_ASSERT(false);
+    } catch (std::logic_error const &e) {
+    }
+    try {
+        obitstream::ref(&reused[0], sizeof(reused)).write_digest();
+        TEST_ASSERT(false);
+    } catch (std::logic_error const &e) {
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    using namespace org::sqg;
+
+    // once with the SIMD kernels, once with the portable fallbacks.
+    TEST_ASSERT(test_checksums() == EXIT_SUCCESS);
+    enable_simd_kernels(false);
+    TEST_ASSERT(test_checksums() == EXIT_SUCCESS);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+#include "../src/lanestream.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            std::cerr << #CONDITION << " failed!" << std::endl; \
+            return EXIT_FAILURE; \
+        } \
+    } while (0)
+
+// a record is a 5-bit width followed by a value of that width.
+static std::uint32_t value_of(std::size_t i) {
+    return static_cast<std::uint32_t>(i * 2654435761u);
+}
+
+static std::size_t width_of(std::size_t i) {
+    return (i * 7) % 32;
+}
+
+static int test_lanes(std::size_t N) {
+    using namespace std;
+    using namespace org::sqg;
+
+    size_t const records = N * 40;
+
+    olanestream ols(N);
+    for (size_t i = 0; i < records; ++i) {
+        size_t w = width_of(i);
+        ols.write_uint(w, 5);
+        ols.write_uint(value_of(i) & ((1ULL << w) - 1), w);
+        ols.next();
+    }
+    TEST_ASSERT(ols.size() == ols.rows() * N * 4);
+
+    // every lane in step: all widths, then all values.
+    ilanestream ils = ilanestream::ref(ols.data(), ols.size(), N);
+    vector<uint32_t> widths(N), values(N);
+    vector<uint8_t> w8(N);
+    for (size_t i = 0; i < records; i += N) {
+        ils.read_uint(5, &widths[0]);
+        for (size_t l = 0; l < N; ++l) {
+            TEST_ASSERT(widths[l] == width_of(i + l));
+            w8[l] = widths[l];
+        }
+        ils.read_uints(&w8[0], &values[0]);
+        for (size_t l = 0; l < N; ++l)
+            TEST_ASSERT(values[l] == (value_of(i + l) & ((1ULL << w8[l]) - 1)));
+    }
+
+    // the interleaved words framed into a plain bitstream payload.
+    vector<byte> buf(ols.size() + 5);
+    obitstream obs = obitstream::ref(&buf[0], buf.size());
+    ols.write_to(obs);
+    ibitstream ibs = ibitstream::ref(&buf[0], buf.size());
+    ilanestream copy = ilanestream::read_from(ibs);
+    TEST_ASSERT(copy.lanes() == N);
+    TEST_ASSERT(copy.rows() == ols.rows());
+    for (size_t i = 0; i < records; ++i) {
+        size_t w = copy.read_lane(i % N, 5);
+        TEST_ASSERT(w == width_of(i));
+        TEST_ASSERT(copy.read_lane(i % N, w) == (value_of(i) & ((1ULL << w) - 1)));
+    }
+
+    // running off the end of the lanes.
+    ilanestream tail = ilanestream::ref(ols.data(), ols.size(), N);
+    try {
+        tail.read_uint(32, &values[0]);
+        for (size_t r = 1; r <= ols.rows(); ++r)
+            tail.read_uint(32, &values[0]);
+        TEST_ASSERT(false);
+    } catch (bitstream_error const &e) {
+    }
+
+    // widths past 32 bits are refused, not truncated.
+    ilanestream wide = ilanestream::ref(ols.data(), ols.size(), N);
+    try {
+        wide.read_uint((size_t(1) << 32) + 1, &values[0]);
+        TEST_ASSERT(false);
+    } catch (bitstream_error const &e) {
+    }
+    try {
+        wide.read_uint(33, &values[0]);
+        TEST_ASSERT(false);
+    } catch (bitstream_error const &e) {
+    }
+    wide.read_uint(5, &values[0]);
+    for (size_t l = 0; l < N; ++l)
+        TEST_ASSERT(values[l] == width_of(l));
+
+    // a header claiming more words than the payload holds.
+    ibitstream shortened = ibitstream::ref(&buf[0], 5 + 4);
+    try {
+        ilanestream::read_from(shortened);
+        TEST_ASSERT(false);
+    } catch (bitstream_error const &e) {
+    }
+
+    // every lane used up to its last bit, then zero-width reads.
+    olanestream full(N);
+    for (size_t i = 0; i < N * 3; ++i)
+        full.write_uint(i, 32).next();
+    ilanestream done = ilanestream::ref(full.data(), full.size(), N);
+    for (size_t r = 0; r < 3; ++r) {
+        done.read_uint(32, &values[0]);
+        for (size_t l = 0; l < N; ++l)
+            TEST_ASSERT(values[l] == r * N + l);
+    }
+    vector<uint8_t> none(N, 0);
+    done.read_uints(&none[0], &values[0]);
+    for (size_t l = 0; l < N; ++l)
+        TEST_ASSERT(values[l] == 0);
+    done.read_uint(0, &values[0]);
+    TEST_ASSERT(done.read_lane(N - 1, 0) == 0);
+
+    // an empty stream reads nothing but zero-width fields.
+    olanestream empty(N);
+    ilanestream nothing = ilanestream::ref(empty.data(), empty.size(), N);
+    TEST_ASSERT(nothing.rows() == 0);
+    nothing.read_uint(0, &values[0]);
+    try {
+        nothing.read_uint(1, &values[0]);
+        TEST_ASSERT(false);
+    } catch (bitstream_error const &e) {
+    }
+
+    // record order: interleave a plain payload and take it apart again.
+    vector<size_t> lengths;
+    vector<byte> plain(512, 0);
+    obitstream pobs = obitstream::ref(&plain[0], plain.size());
+    size_t total = 0;
+    for (size_t i = 0; i < N * 5 + 3; ++i) {
+        size_t n = (i * 13) % 71;
+        for (size_t b = n; b > 0; ) {
+            size_t k = b < 32 ? b : 32;
+            pobs.write_uint(value_of(i + b), k);
+            b -= k;
+        }
+        lengths.push_back(n);
+        total += n;
+    }
+    ibitstream pibs = ibitstream::ref(&plain[0], plain.size());
+    olanestream interleaved(N);
+    interleaved.write_records(pibs, lengths);
+    TEST_ASSERT(pibs.tell() == total);
+
+    vector<byte> back(512, 0);
+    obitstream bobs = obitstream::ref(&back[0], back.size());
+    ilanestream::ref(interleaved.data(), interleaved.size(), N).read_records(bobs, lengths);
+    TEST_ASSERT(back == plain);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    // once with the SIMD kernels, once with the portable fallbacks.
+    for (int simd = 1; simd >= 0; --simd) {
+        org::sqg::enable_simd_kernels(simd);
+        TEST_ASSERT(test_lanes(4) == EXIT_SUCCESS);
+        TEST_ASSERT(test_lanes(8) == EXIT_SUCCESS);
+        TEST_ASSERT(test_lanes(16) == EXIT_SUCCESS);
+    }
+    try {
+        org::sqg::olanestream ols(5);
+        TEST_ASSERT(false);
+    } catch (std::invalid_argument const &e) {
+    }
+    return EXIT_SUCCESS;
+}
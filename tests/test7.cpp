@@ -0,0 +1,86 @@
+#include "../src/bitstream.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#define TEST_ASSERT(CONDITION) \
+    do { \
+        if (!(CONDITION)) { \
+            std::cerr << #CONDITION << " failed!" << std::endl; \
+            return EXIT_FAILURE; \
+        } \
+    } while (0)
+
+// the old way: seek and read at every bit offset.
+static std::vector<std::size_t> brute_force(org::sqg::ibitstream &ibs, std::size_t size,
+        std::uint64_t pattern, std::size_t bits) {
+    std::vector<std::size_t> all;
+    for (std::size_t off = 0; off + bits <= size; ++off) {
+        ibs.seek(off, std::ios::beg);
+        if (ibs.read_uint(bits) == pattern)
+            all.push_back(off);
+    }
+    return all;
+}
+
+static int test_find() {
+    using namespace std;
+    using namespace org::sqg;
+
+    byte buf[1000];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+
+    // plant start codes at assorted bit offsets.
+    size_t const planted[] = { 3, 100, 1001, 2048, 4095, 6000, 7975 };
+    obitstream obs = obitstream::ref(&buf[0], sizeof(buf));
+    for (size_t k = 0; k < sizeof(planted) / sizeof(planted[0]); ++k) {
+        obs.seek(planted[k], ios::beg);
+        obs.write_uint(0x000001, 24);
+    }
+
+    ibitstream ibs = ibitstream::ref(buf);
+    size_t const size = sizeof(buf) * 8;
+
+    vector<size_t> codes = ibs.find_all(0x000001, 24);
+    TEST_ASSERT(codes == brute_force(ibs, size, 0x000001, 24));
+    for (size_t k = 0; k < sizeof(planted) / sizeof(planted[0]); ++k) {
+        TEST_ASSERT(ibs.find(0x000001, 24, planted[k]) == planted[k]);
+        TEST_ASSERT(ibs.find(0x000001, 24, planted[k] + 1) > planted[k]);
+    }
+    TEST_ASSERT(ibs.find(0x000001, 24, planted[6] + 1) == ibitstream::npos);
+
+    // a pattern copied from the data at every shift, and a short one.
+    for (size_t off = 4000; off < 4016; ++off) {
+        ibs.seek(off, ios::beg);
+        uint64_t word = ibs.read_uint(32);
+        TEST_ASSERT(ibs.find_all(word, 32) == brute_force(ibs, size, word, 32));
+        TEST_ASSERT(ibs.find(word, 32) <= off);
+        ibs.seek(off, ios::beg);
+        uint64_t wide = ibs.read_uint(32) << 32;
+        wide |= ibs.read_uint(32);
+        TEST_ASSERT(ibs.find(wide, 64, off) == off);
+    }
+    TEST_ASSERT(ibs.find_all(0x5, 3) == brute_force(ibs, size, 0x5, 3));
+
+    // find leaves the position alone.
+    ibs.seek(0, ios::beg);
+    ibs.find(0x000001, 24);
+    TEST_ASSERT(ibs.read_uint(8) == buf[0]);
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    using namespace org::sqg;
+
+    // once with the SIMD prefilter, once with the portable one.
+    TEST_ASSERT(test_find() == EXIT_SUCCESS);
+    enable_simd_kernels(false);
+    TEST_ASSERT(test_find() == EXIT_SUCCESS);
+    return EXIT_SUCCESS;
+}